@@ -1,9 +1,13 @@
 // Copyright (c) 2023-2024, Pedro López-Cabanillas
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <algorithm>
+
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QDirIterator>
+#include <QFile>
 #include <QFileInfo>
 #include <QList>
 #include <QRegularExpression>
@@ -12,9 +16,14 @@
 #include <QString>
 
 #include "freedesktoptheme.h"
+#include "iconindexservice.h"
+
+static const quint32 IndexMagic = 0x49544956; // "ITIV"
+static const quint32 IndexVersion = 3;
 
-FreedesktopTheme::FreedesktopTheme(QObject *parent)
+FreedesktopTheme::FreedesktopTheme(QObject *parent, bool useIndexService)
     : QObject{parent}
+    , m_useIndexService{useIndexService}
 {
     loadThemes();
     loadTheme();
@@ -68,6 +77,14 @@ void FreedesktopTheme::loadTheme()
                 m_themeContexts.append(context);
                 auto newKey = key;
                 newKey.remove("/Context"_L1);
+                DirStats &stats = m_dirStats[newKey];
+                stats.context = context;
+                stats.type = indexReader.value(newKey + "/Type"_L1, "Threshold"_L1).toString();
+                stats.size = indexReader.value(newKey + "/Size"_L1).toInt();
+                stats.scale = indexReader.value(newKey + "/Scale"_L1, 1).toInt();
+                stats.minSize = indexReader.value(newKey + "/MinSize"_L1, stats.size).toInt();
+                stats.maxSize = indexReader.value(newKey + "/MaxSize"_L1, stats.size).toInt();
+                stats.threshold = indexReader.value(newKey + "/Threshold"_L1, 2).toInt();
                 auto dir1 = newKey.left(newKey.indexOf('/'));
                 QRegularExpressionMatch m = rex.match(dir1);
                 if (m.hasMatch() || dir1 == "scalable") {
@@ -83,13 +100,25 @@ void FreedesktopTheme::loadTheme()
         m_parents.removeAll(QString());
         m_themeContexts.sort();
         m_themeContexts.removeDuplicates();
+        // first context in key order wins, like the former linear search
+        for (auto it = m_contextDirs.cbegin(); it != m_contextDirs.cend(); ++it) {
+            foreach (const auto &dir, it.value()) {
+                if (!m_dirContexts.contains(dir)) {
+                    m_dirContexts.insert(dir, it.key());
+                }
+            }
+        }
     }
 }
 
 void FreedesktopTheme::loadThemeIcons()
 {
+    if (m_useIndexService && attachIndex()) {
+        return;
+    }
     QElapsedTimer timer;
     timer.start();
+    m_stamp = themeStamp(currentTheme());
     const auto themePath = m_themes[currentTheme()];
     QRegularExpression rex(themePath + "/(.*)/(.*)");
     QDir iconDir(themePath);
@@ -98,9 +127,10 @@ void FreedesktopTheme::loadThemeIcons()
     QDirIterator iterator(iconDir, QDirIterator::FollowSymlinks | QDirIterator::Subdirectories);
     while (iterator.hasNext()) {
         iterator.next();
-        const auto iconName = iterator.fileInfo().baseName();
+        const QFileInfo fileInfo = iterator.fileInfo();
+        const auto iconName = fileInfo.completeBaseName();
         QString dir, context;
-        QRegularExpressionMatch match = rex.match(iterator.fileInfo().path());
+        QRegularExpressionMatch match = rex.match(fileInfo.path());
         if (match.hasMatch()) {
             dir = match.captured(1);
             context = dirContext(dir);
@@ -110,26 +140,144 @@ void FreedesktopTheme::loadThemeIcons()
             }
         }
         if (!context.isEmpty() && QIcon::hasThemeIcon(iconName)) {
-            if (m_iconNames[context].contains(iconName))
-                continue;
             m_iconNames[context].insert(iconName);
+            const auto relativeDir = fileInfo.path().mid(themePath.length() + 1);
+            auto it = m_dirStats.find(relativeDir);
+            if (it == m_dirStats.end()) {
+                // folders not declared in index.theme have no size: not indexed
+                continue;
+            }
+            DirStats &stats = it.value();
+            stats.icons++;
+            stats.bytes += fileInfo.size();
+            IconEntry entry;
+            entry.context = context;
+            entry.dir = relativeDir;
+            entry.size = stats.size;
+            entry.scale = stats.scale;
+            entry.format = fileInfo.suffix().toLower();
+            entry.bytes = fileInfo.size();
+            entry.filePath = fileInfo.filePath();
+            m_iconIndex[iconName].append(entry);
+        }
+    }
+}
+
+bool FreedesktopTheme::attachIndex()
+{
+    const auto fileName = IconIndexService::requestIndex(currentTheme());
+    if (fileName.isEmpty() || QFileInfo(fileName).absolutePath() != IconIndexService::indexDir()) {
+        return false;
+    }
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    uchar *data = file.map(0, file.size());
+    if (data == nullptr) {
+        return false;
+    }
+    const bool ok = restoreIndex(
+        QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size()));
+    file.unmap(data);
+    return ok;
+}
+
+QByteArray FreedesktopTheme::saveIndex() const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_4);
+    out << IndexMagic << IndexVersion << m_themes[currentTheme()] << m_stamp;
+    out << m_iconNames << m_iconIndex << m_dirStats;
+    return data;
+}
+
+bool FreedesktopTheme::restoreIndex(const QByteArray &data)
+{
+    quint32 magic, version;
+    QString themePath;
+    qint64 stamp;
+    QMap<QString, QSet<QString>> iconNames;
+    QHash<QString, QList<IconEntry>> iconIndex;
+    QMap<QString, DirStats> dirStats;
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_6_4);
+    in >> magic >> version;
+    if (magic != IndexMagic || version != IndexVersion) {
+        return false;
+    }
+    in >> themePath >> stamp;
+    if (themePath != m_themes[currentTheme()] || stamp != themeStamp(currentTheme())) {
+        return false;
+    }
+    in >> iconNames >> iconIndex >> dirStats;
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+    m_iconNames = iconNames;
+    m_iconIndex = iconIndex;
+    m_dirStats = dirStats;
+    m_stamp = stamp;
+    return true;
+}
+
+qint64 FreedesktopTheme::themeStamp(const QString &themeName) const
+{
+    using namespace Qt::Literals::StringLiterals;
+    // sum of the modification times of index.theme and the folders it
+    // declares: adding, removing or renaming icons (which is how package
+    // managers replace them) changes a folder, but overwriting a file in
+    // place does not, so such edits keep a stale index until the folder changes
+    const QDir themeDir(m_themes.value(themeName));
+    const auto indexPath = themeDir.absoluteFilePath("index.theme"_L1);
+    const QSettings indexReader(indexPath, QSettings::IniFormat);
+    QList<QString> dirs = indexReader.value("Icon Theme/Directories"_L1).toStringList();
+    dirs += indexReader.value("Icon Theme/ScaledDirectories"_L1).toStringList();
+    dirs.removeDuplicates();
+    qint64 stamp = 0;
+    foreach (const auto &path, QList<QString>{indexPath} + dirs) {
+        const QDateTime modified = QFileInfo(themeDir, path).lastModified();
+        if (modified.isValid()) {
+            stamp += modified.toMSecsSinceEpoch();
         }
     }
+    return stamp;
+}
+
+qint64 FreedesktopTheme::indexStamp() const
+{
+    return m_stamp;
 }
 
 void FreedesktopTheme::changeTheme(const QString themeName)
 {
     if (m_themes.contains(themeName) && themeName != currentTheme()) {
-        m_iconNames.clear();
-        m_themeContexts.clear();
-        m_contextDirs.clear();
         QIcon::setThemeName(themeName);
-        loadTheme();
-        loadThemeIcons();
-        //dumpTheme();
+        reloadTheme();
     }
 }
 
+void FreedesktopTheme::reloadThemes()
+{
+    loadThemes();
+}
+
+void FreedesktopTheme::reloadTheme()
+{
+    m_iconNames.clear();
+    m_iconIndex.clear();
+    m_dirStats.clear();
+    m_themeContexts.clear();
+    m_contextDirs.clear();
+    m_dirContexts.clear();
+    // resetting the search paths drops Qt's cached theme data
+    QIcon::setThemeSearchPaths(QIcon::themeSearchPaths());
+    loadTheme();
+    loadThemeIcons();
+    //dumpTheme();
+}
+
 /*void FreedesktopTheme::dumpTheme()
 {
     qDebug() << Q_FUNC_INFO;
@@ -187,11 +335,94 @@ QList<QString> FreedesktopTheme::contextIcons(const QString &context) const
 
 QString FreedesktopTheme::dirContext(const QString &dirName) const
 {
-    foreach (const auto &key, m_contextDirs.keys()) {
-        const QSet<QString> &set = m_contextDirs[key];
-        if (set.contains(dirName)) {
-            return key;
+    return m_dirContexts.value(dirName);
+}
+
+QList<IconEntry> FreedesktopTheme::iconEntries(const QString &iconName) const
+{
+    return m_iconIndex.value(iconName);
+}
+
+QList<QString> FreedesktopTheme::iconContexts(const QString &iconName) const
+{
+    QList<QString> tmp;
+    foreach (const auto &entry, m_iconIndex.value(iconName)) {
+        tmp.append(entry.context);
+    }
+    tmp.sort();
+    tmp.removeDuplicates();
+    return tmp;
+}
+
+QList<int> FreedesktopTheme::iconSizes(const QString &iconName) const
+{
+    QList<int> tmp;
+    foreach (const auto &entry, m_iconIndex.value(iconName)) {
+        if (!tmp.contains(entry.size)) {
+            tmp.append(entry.size);
         }
     }
-    return QString();
+    std::sort(tmp.begin(), tmp.end());
+    return tmp;
+}
+
+QMap<QString, DirStats> FreedesktopTheme::dirStatistics() const
+{
+    return m_dirStats;
+}
+
+ContextStats FreedesktopTheme::contextStatistics(const QString &context) const
+{
+    ContextStats total;
+    foreach (const auto &stats, m_dirStats) {
+        if (stats.context == context) {
+            total.icons += stats.icons;
+            total.bytes += stats.bytes;
+        }
+    }
+    return total;
+}
+
+// DirectoryMatchesSize() from the icon theme specification
+bool DirStats::matchesSize(int iconSize, int iconScale) const
+{
+    using namespace Qt::Literals::StringLiterals;
+    if (scale != iconScale) {
+        return false;
+    }
+    if (type == "Fixed"_L1) {
+        return size == iconSize;
+    }
+    if (type == "Scalable"_L1) {
+        return minSize <= iconSize && iconSize <= maxSize;
+    }
+    return size - threshold <= iconSize && iconSize <= size + threshold;
+}
+
+QDataStream &operator<<(QDataStream &out, const IconEntry &entry)
+{
+    out << entry.context << entry.dir << entry.size << entry.scale << entry.format << entry.bytes
+        << entry.filePath;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, IconEntry &entry)
+{
+    in >> entry.context >> entry.dir >> entry.size >> entry.scale >> entry.format >> entry.bytes
+        >> entry.filePath;
+    return in;
+}
+
+QDataStream &operator<<(QDataStream &out, const DirStats &stats)
+{
+    out << stats.context << stats.type << stats.size << stats.scale << stats.minSize
+        << stats.maxSize << stats.threshold << stats.icons << stats.bytes;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, DirStats &stats)
+{
+    in >> stats.context >> stats.type >> stats.size >> stats.scale >> stats.minSize
+        >> stats.maxSize >> stats.threshold >> stats.icons >> stats.bytes;
+    return in;
 }
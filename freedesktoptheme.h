@@ -4,19 +4,61 @@
 #ifndef FREEDESKTOPTHEME_H
 #define FREEDESKTOPTHEME_H
 
+#include <QByteArray>
+#include <QDataStream>
 #include <QElapsedTimer>
+#include <QHash>
 #include <QIcon>
 #include <QMap>
 #include <QObject>
 #include <QSet>
 #include <QString>
 
+struct IconEntry
+{
+    QString context;
+    QString dir;  // relative to the theme path
+    int size = 0;
+    int scale = 1;
+    QString format; // file suffix: png, svg, xpm...
+    qint64 bytes = 0;
+    QString filePath;
+};
+
+struct DirStats
+{
+    QString context;
+    QString type; // Fixed, Scalable or Threshold
+    int size = 0;
+    int scale = 1;
+    int minSize = 0;
+    int maxSize = 0;
+    int threshold = 2;
+    int icons = 0;
+    qint64 bytes = 0;
+
+    bool matchesSize(int iconSize, int iconScale) const;
+};
+
+struct ContextStats
+{
+    int icons = 0;
+    qint64 bytes = 0;
+};
+
+QDataStream &operator<<(QDataStream &out, const IconEntry &entry);
+QDataStream &operator>>(QDataStream &in, IconEntry &entry);
+QDataStream &operator<<(QDataStream &out, const DirStats &stats);
+QDataStream &operator>>(QDataStream &in, DirStats &stats);
+
 class FreedesktopTheme : public QObject
 {
     Q_OBJECT
 public:
-    explicit FreedesktopTheme(QObject *parent = nullptr);
+    explicit FreedesktopTheme(QObject *parent = nullptr, bool useIndexService = true);
     void changeTheme(const QString themeName);
+    void reloadTheme();
+    void reloadThemes();
 
     QList<QString> themeNames() const;
     QList<QString> themeContexts() const;
@@ -27,20 +69,35 @@ public:
     QMap<QString, QSet<QString>> iconNames() const;
     QMap<QString, QString> themes() const;
     QIcon loadIcon(const QString &iconName) const;
+    QList<IconEntry> iconEntries(const QString &iconName) const;
+    QList<QString> iconContexts(const QString &iconName) const;
+    QList<int> iconSizes(const QString &iconName) const;
+    QMap<QString, DirStats> dirStatistics() const;
+    ContextStats contextStatistics(const QString &context) const;
+    qint64 themeStamp(const QString &themeName) const;
+    qint64 indexStamp() const;
+    QByteArray saveIndex() const;
+    bool restoreIndex(const QByteArray &data);
     //void dumpTheme();
 
 protected:
     void loadThemes();
     void loadTheme();
     void loadThemeIcons();
+    bool attachIndex();
 
 private:
     QList<QString> m_themeNames;
     QList<QString> m_themeContexts;
     QMap<QString, QSet<QString>> m_contextDirs; // [key=context]->paths
+    QHash<QString, QString> m_dirContexts; // [key=path]->context
     QMap<QString, QString> m_themes; // [key=name]->path
     QMap<QString, QSet<QString>> m_iconNames; //[key=context]->{icon_name, ...}
+    QHash<QString, QList<IconEntry>> m_iconIndex; // [key=icon_name]->{entry, ...}
+    QMap<QString, DirStats> m_dirStats; // [key=relative dir]->stats
     QList<QString> m_parents;
+    const bool m_useIndexService;
+    qint64 m_stamp = 0; // themeStamp() when the icons were scanned
     const QString m_systemTheme = QIcon::themeName();
 };
 
@@ -0,0 +1,126 @@
+// Copyright (c) 2023-2024, Pedro López-Cabanillas
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "iconindexservice.h"
+
+IconIndexService::IconIndexService(QObject *parent)
+    : QObject{parent}
+    , m_server(new QLocalServer(this))
+{
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &IconIndexService::newConnection);
+}
+
+bool IconIndexService::listen()
+{
+    QLocalSocket probe;
+    probe.connectToServer(serverName());
+    if (probe.waitForConnected(100)) {
+        // another daemon is already serving
+        return false;
+    }
+    QLocalServer::removeServer(serverName());
+    return m_server->listen(serverName());
+}
+
+QString IconIndexService::indexDir()
+{
+    using namespace Qt::Literals::StringLiterals;
+    // the runtime location is private to the user (mode 0700), unlike /tmp
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation));
+    const auto name = QCoreApplication::applicationName() + "-index"_L1;
+    if (dir.mkpath(name)) {
+        QFile::setPermissions(dir.absoluteFilePath(name),
+                              QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+    }
+    return dir.absoluteFilePath(name);
+}
+
+QString IconIndexService::serverName()
+{
+    using namespace Qt::Literals::StringLiterals;
+    return QDir(indexDir()).absoluteFilePath("socket"_L1);
+}
+
+QString IconIndexService::indexPath(const QString &themeName)
+{
+    using namespace Qt::Literals::StringLiterals;
+    return QDir(indexDir()).absoluteFilePath(themeName + ".index"_L1);
+}
+
+QString IconIndexService::requestIndex(const QString &themeName)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName(), QIODevice::ReadWrite);
+    if (!socket.waitForConnected(100)) {
+        return QString();
+    }
+    socket.write(themeName.toUtf8() + '\n');
+    socket.waitForBytesWritten();
+    while (!socket.canReadLine()) {
+        // the daemon answers after scanning, however long that takes:
+        // only give up when it goes away
+        if (!socket.waitForReadyRead(1000)
+            && socket.state() != QLocalSocket::ConnectedState) {
+            return QString();
+        }
+    }
+    return QString::fromUtf8(socket.readLine()).trimmed();
+}
+
+void IconIndexService::newConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QLocalSocket *socket = m_server->nextPendingConnection();
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [=] { readRequest(socket); });
+    }
+}
+
+void IconIndexService::readRequest(QLocalSocket *socket)
+{
+    while (socket->canReadLine()) {
+        const auto themeName = QString::fromUtf8(socket->readLine()).trimmed();
+        socket->write(buildIndex(themeName).toUtf8() + '\n');
+    }
+}
+
+QString IconIndexService::buildIndex(const QString &themeName)
+{
+    if (!m_theme.themes().contains(themeName)) {
+        // may have been installed after the daemon started
+        m_theme.reloadThemes();
+        if (!m_theme.themes().contains(themeName)) {
+            return QString();
+        }
+    }
+    // checked on every request, so upgraded themes get rescanned
+    const auto stamp = m_theme.themeStamp(themeName);
+    if (m_indexFiles.contains(themeName) && m_indexStamps.value(themeName) == stamp) {
+        return m_indexFiles[themeName];
+    }
+    if (themeName != m_theme.currentTheme()) {
+        m_theme.changeTheme(themeName);
+    } else if (m_theme.indexStamp() != stamp) {
+        m_theme.reloadTheme();
+    }
+    const auto fileName = indexPath(themeName);
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return QString();
+    }
+    file.write(m_theme.saveIndex());
+    if (!file.commit()) {
+        return QString();
+    }
+    QFile::setPermissions(fileName, QFile::ReadOwner | QFile::ReadUser);
+    m_indexFiles.insert(themeName, fileName);
+    m_indexStamps.insert(themeName, m_theme.indexStamp());
+    return fileName;
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2023-2024, Pedro López-Cabanillas
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef ICONINDEXSERVICE_H
+#define ICONINDEXSERVICE_H
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMap>
+#include <QObject>
+#include <QString>
+
+#include "freedesktoptheme.h"
+
+class IconIndexService : public QObject
+{
+    Q_OBJECT
+public:
+    explicit IconIndexService(QObject *parent = nullptr);
+    bool listen();
+
+    static QString indexDir();
+    static QString serverName();
+    static QString indexPath(const QString &themeName);
+    static QString requestIndex(const QString &themeName);
+
+protected:
+    void newConnection();
+    void readRequest(QLocalSocket *socket);
+    QString buildIndex(const QString &themeName);
+
+private:
+    QLocalServer *m_server;
+    FreedesktopTheme m_theme{nullptr, false};
+    QMap<QString, QString> m_indexFiles; // [key=theme]->index file
+    QMap<QString, qint64> m_indexStamps; // [key=theme]->themeStamp() of the index
+};
+
+#endif // ICONINDEXSERVICE_H
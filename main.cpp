@@ -1,10 +1,102 @@
 // Copyright (c) 2023-2024, Pedro López-Cabanillas
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <algorithm>
+
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QGuiApplication>
+#include <QIcon>
+#include <QLocale>
 #include <QObject>
+#include <QTextStream>
 
+#include "iconindexservice.h"
 #include "mainwindow.h"
+#include "themeextractor.h"
+
+static int runExtract(const QCommandLineParser &parser)
+{
+    using namespace Qt::Literals::StringLiterals;
+    QTextStream out(stdout);
+    if (!parser.isSet("output"_L1)) {
+        qWarning("Missing --output directory");
+        return 1;
+    }
+    QFile listFile;
+    if (parser.value("extract"_L1) == QLatin1String("-")) {
+        if (!listFile.open(stdin, QIODevice::ReadOnly | QIODevice::Text)) {
+            qWarning("Cannot read standard input");
+            return 1;
+        }
+    } else {
+        listFile.setFileName(parser.value("extract"_L1));
+        if (!listFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            qWarning("Cannot read %s", qPrintable(listFile.fileName()));
+            return 1;
+        }
+    }
+    QList<QString> iconNames;
+    while (!listFile.atEnd()) {
+        const auto line = QString::fromUtf8(listFile.readLine()).trimmed();
+        if (!line.isEmpty() && !line.startsWith('#')) {
+            iconNames.append(line);
+        }
+    }
+    const auto themeName = parser.value("theme"_L1).isEmpty() ? QIcon::themeName()
+                                                              : parser.value("theme"_L1);
+    const QList<QString> searchPaths = QIcon::themeSearchPaths();
+    const bool found = std::any_of(searchPaths.cbegin(),
+                                   searchPaths.cend(),
+                                   [&](const QString &path) {
+                                       return QFile::exists(
+                                           QDir(path).filePath(themeName + "/index.theme"_L1));
+                                   });
+    if (!found) {
+        qWarning("Unknown theme %s", qPrintable(themeName));
+        return 1;
+    }
+    // scan only the requested theme, not the current one
+    QIcon::setThemeName(themeName);
+    FreedesktopTheme theme;
+    ThemeExtractor extractor(&theme);
+    const ExtractStats stats = extractor.extract(themeName,
+                                                 iconNames,
+                                                 parser.value("output"_L1));
+    const QLocale locale;
+    const double seconds = qMax<qint64>(stats.copyElapsed, 1) / 1000.0;
+    out << QObject::tr("%1 of %2 icons, %3 files, %4 links, %5 errors")
+               .arg(stats.icons)
+               .arg(iconNames.count())
+               .arg(stats.files)
+               .arg(stats.links)
+               .arg(stats.errors)
+        << Qt::endl;
+    out << QObject::tr("copied %1 in %2 ms (%3/s), output size %4, total time %5 ms")
+               .arg(locale.formattedDataSize(stats.bytes))
+               .arg(stats.copyElapsed)
+               .arg(locale.formattedDataSize(qRound64(stats.bytes / seconds)))
+               .arg(locale.formattedDataSize(stats.outputBytes))
+               .arg(stats.elapsed)
+        << Qt::endl;
+    if (!stats.missingIcons.isEmpty()) {
+        out << QObject::tr("missing: %1").arg(stats.missingIcons.join(QLatin1String(", ")))
+            << Qt::endl;
+    }
+    return stats.errors > 0 ? 1 : 0;
+}
+
+static int runDaemon()
+{
+    IconIndexService service;
+    if (!service.listen()) {
+        qWarning("Cannot listen on %s", qPrintable(IconIndexService::serverName()));
+        return 1;
+    }
+    return QGuiApplication::exec();
+}
 
 int main(int argc, char *argv[])
 {
@@ -12,7 +104,50 @@ int main(int argc, char *argv[])
     QApplication::setApplicationName(QT_STRINGIFY(APPNAME));
     QApplication::setApplicationVersion(QT_STRINGIFY(APPVERSION));
     QApplication::setApplicationDisplayName(QObject::tr("Icon Theme Viewer"));
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption daemonOption("index-daemon",
+                                    QObject::tr("Serve theme indexes to other instances."));
+    parser.addOption(daemonOption);
+    QCommandLineOption extractOption("extract",
+                                     QObject::tr("Extract the icons listed in <file> ('-' for "
+                                                 "stdin) into a standalone theme."),
+                                     QObject::tr("file"));
+    parser.addOption(extractOption);
+    QCommandLineOption outputOption("output",
+                                    QObject::tr("Output directory for the extracted theme."),
+                                    QObject::tr("directory"));
+    parser.addOption(outputOption);
+    QCommandLineOption themeOption("theme",
+                                   QObject::tr("Theme to extract from (default: current)."),
+                                   QObject::tr("name"));
+    parser.addOption(themeOption);
+
+    // the batch modes are picked before any application object exists, so
+    // that they need neither widgets nor a display
+    QStringList arguments;
+    for (int i = 0; i < argc; ++i) {
+        arguments.append(QString::fromLocal8Bit(argv[i]));
+    }
+    parser.parse(arguments);
+    if (parser.isSet(daemonOption) || parser.isSet(extractOption)) {
+#if defined(Q_OS_UNIX) && !defined(Q_OS_MACOS)
+        if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")
+            && qEnvironmentVariableIsEmpty("DISPLAY")
+            && qEnvironmentVariableIsEmpty("WAYLAND_DISPLAY")) {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        }
+#endif
+        QGuiApplication app(argc, argv);
+        parser.process(app);
+        return parser.isSet(daemonOption) ? runDaemon() : runExtract(parser);
+    }
+
     QApplication app(argc, argv);
+    parser.process(app);
+
     MainWindow win;
     win.show();
     return app.exec();
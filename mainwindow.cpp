@@ -7,6 +7,7 @@
 #include <QDir>
 #include <QGridLayout>
 #include <QLabel>
+#include <QLocale>
 #include <QMap>
 #include <QMenu>
 #include <QMessageBox>
@@ -72,6 +73,10 @@ MainWindow::MainWindow(QWidget *parent)
     ui->toolBar->addAction(m_exitAction);
     setPseudoCaption(ui->toolBar);
 
+    // item status tips would erase a plain status bar message
+    m_statsLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_statsLabel);
+
     QStringList styleNames = QStyleFactory::keys();
     foreach (const auto &n, styleNames) {
         ui->cboStyle->addItem(n.toLower());
@@ -102,15 +107,28 @@ void MainWindow::refreshIcons()
     // timer.start();
     statusBar()->clearMessage();
     deleteAllButtons();
-    QList<QString> iconNames = m_theme.contextIcons(ui->cboContext->currentText());
+    const QString context = ui->cboContext->currentText();
+    QList<QString> iconNames = m_theme.contextIcons(context);
     for (int i = 0; i < iconNames.count(); ++i) {
         QString name = iconNames[i];
+        QStringList sizes;
+        foreach (const auto size, m_theme.iconSizes(name)) {
+            sizes.append(QString::number(size));
+        }
         QListWidgetItem *item = new QListWidgetItem(ui->buttonsWidget);
-        item->setToolTip(name);
+        item->setToolTip(tr("%1\nSizes: %2\nContexts: %3")
+                             .arg(name,
+                                  sizes.join(QLatin1String(", ")),
+                                  m_theme.iconContexts(name).join(QLatin1String(", "))));
         item->setIcon(m_theme.loadIcon(name));
         item->setStatusTip(name);
         item->setBackground(palette().window());
     }
+    const ContextStats stats = m_theme.contextStatistics(context);
+    m_statsLabel->setText(tr("%1 icons, %2 files, %3")
+                             .arg(iconNames.count())
+                             .arg(stats.icons)
+                             .arg(QLocale().formattedDataSize(stats.bytes)));
     //qDebug() << Q_FUNC_INFO << "elapsed time:" << timer.elapsed();
 }
 
@@ -5,6 +5,7 @@
 #define MAINWINDOW_H
 
 #include <QAction>
+#include <QLabel>
 #include <QToolButton>
 
 #include "framelesswindow.h"
@@ -42,6 +43,7 @@ private:
     QAction *m_exitAction;
     QAction *m_titleAction;
     QToolButton *m_appmenu;
+    QLabel *m_statsLabel;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,413 @@
+// Copyright (c) 2023-2024, Pedro López-Cabanillas
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <atomic>
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QPair>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QSet>
+#include <QSettings>
+#include <QTextStream>
+#include <QtConcurrent>
+
+#ifdef Q_OS_UNIX
+#include <climits>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#endif
+
+#include "themeextractor.h"
+
+struct SourceFile
+{
+    QString path;
+    QString root; // source theme path
+};
+
+struct CopyJob
+{
+    QString source;
+    QString target;
+};
+
+static QString readLink(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    char buffer[PATH_MAX];
+    const ssize_t len = ::readlink(QFile::encodeName(path).constData(), buffer, sizeof(buffer));
+    if (len > 0) {
+        return QFile::decodeName(QByteArray(buffer, len));
+    }
+#endif
+    return QString();
+}
+
+// Replaces the symlinked folders of a theme relative path by their targets,
+// recording them in dirLinks, as long as the targets stay inside the theme
+static QString resolveDirLinks(const QString &root,
+                               const QString &relative,
+                               QMap<QString, QString> *dirLinks)
+{
+    using namespace Qt::Literals::StringLiterals;
+    QString path = relative;
+    // bounded, in case of link loops
+    for (int depth = 0; depth < 16; ++depth) {
+        const QList<QString> parts = path.split('/');
+        bool changed = false;
+        for (int i = 1; i < parts.count() && !changed; ++i) {
+            const auto prefix = parts.mid(0, i).join('/');
+            const auto prefixPath = QDir(root).filePath(prefix);
+            if (!QFileInfo(prefixPath).isSymLink()) {
+                continue;
+            }
+            const auto linkTarget = readLink(prefixPath);
+            const auto targetRelative = QDir::cleanPath(QFileInfo(prefix).path() + '/'
+                                                        + linkTarget);
+            if (linkTarget.isEmpty() || !QDir::isRelativePath(linkTarget)
+                || targetRelative.startsWith("../"_L1) || targetRelative == ".."_L1
+                || dirLinks->value(prefix, linkTarget) != linkTarget) {
+                return path;
+            }
+            dirLinks->insert(prefix, linkTarget);
+            path = QDir::cleanPath(targetRelative + '/' + parts.mid(i).join('/'));
+            changed = true;
+        }
+        if (!changed) {
+            break;
+        }
+    }
+    return path;
+}
+
+// Raw lines of each section of an index.theme, so that values are copied
+// without going through the QSettings INI parser (';', '\', lists...)
+static QMap<QString, QList<QString>> readIndexSections(const QString &path)
+{
+    QMap<QString, QList<QString>> sections;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return sections;
+    }
+    static const QRegularExpression header("^\\[(.+)\\]\\s*$");
+    QString section;
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        const auto line = in.readLine();
+        const auto match = header.match(line);
+        if (match.hasMatch()) {
+            section = match.captured(1);
+        } else if (!section.isEmpty() && !line.trimmed().isEmpty()) {
+            sections[section].append(line);
+        }
+    }
+    return sections;
+}
+
+static QString lineKey(const QString &line)
+{
+    return line.left(line.indexOf('=')).trimmed();
+}
+
+static bool copyFile(const QString &source, const QString &target, qint64 *bytes)
+{
+#ifdef Q_OS_LINUX
+    const int in = ::open(QFile::encodeName(source).constData(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(in, &st) < 0) {
+        ::close(in);
+        return false;
+    }
+    // never write through a link left in a reused output folder
+    const QByteArray targetName = QFile::encodeName(target);
+    ::unlink(targetName.constData());
+    const int out = ::open(targetName.constData(),
+                           O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                           st.st_mode & 0777);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+    // copy_file_range() keeps the data in the kernel (and may reflink it),
+    // sendfile() covers cross-filesystem copies on older kernels
+    bool useCopyRange = true;
+    bool useSendFile = true;
+    qint64 copied = 0;
+    while (copied < st.st_size) {
+        const size_t remaining = st.st_size - copied;
+        ssize_t n = -1;
+        if (useCopyRange) {
+            n = ::copy_file_range(in, nullptr, out, nullptr, remaining, 0);
+            if (n < 0 && copied == 0
+                && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+                useCopyRange = false;
+                continue;
+            }
+        } else if (useSendFile) {
+            n = ::sendfile(out, in, nullptr, remaining);
+            if (n < 0 && copied == 0 && (errno == ENOSYS || errno == EINVAL)) {
+                useSendFile = false;
+                continue;
+            }
+        } else {
+            char buffer[65536];
+            n = ::read(in, buffer, sizeof(buffer));
+            if (n > 0 && ::write(out, buffer, n) != n) {
+                n = -1;
+            }
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        copied += n;
+    }
+    ::close(in);
+    const bool ok = (::close(out) == 0) && copied == st.st_size;
+    *bytes = copied;
+    return ok;
+#else
+    QFile::remove(target);
+    if (!QFile::copy(source, target)) {
+        return false;
+    }
+    *bytes = QFileInfo(target).size();
+    return true;
+#endif
+}
+
+ThemeExtractor::ThemeExtractor(FreedesktopTheme *theme, QObject *parent)
+    : QObject{parent}
+    , m_theme(theme)
+{}
+
+QString ThemeExtractor::themeIndexPath(const QString &themeName) const
+{
+    using namespace Qt::Literals::StringLiterals;
+    return QDir(m_theme->themes().value(themeName)).absoluteFilePath("index.theme"_L1);
+}
+
+QList<QString> ThemeExtractor::inheritanceChain(const QString &themeName) const
+{
+    using namespace Qt::Literals::StringLiterals;
+    QList<QString> chain;
+    QList<QString> pending{themeName};
+    while (!pending.isEmpty()) {
+        const auto name = pending.takeFirst();
+        if (chain.contains(name) || !m_theme->themes().contains(name)) {
+            continue;
+        }
+        chain.append(name);
+        const QSettings indexReader(themeIndexPath(name), QSettings::IniFormat);
+        // depth first, keeping the order declared in Inherits
+        QList<QString> parents = indexReader.value("Icon Theme/Inherits"_L1).toStringList();
+        parents.removeAll(QString());
+        pending = parents + pending;
+    }
+    if (!chain.contains("hicolor"_L1) && m_theme->themes().contains("hicolor"_L1)) {
+        chain.append("hicolor"_L1);
+    }
+    return chain;
+}
+
+ExtractStats ThemeExtractor::extract(const QString &themeName,
+                                     const QList<QString> &iconNames,
+                                     const QString &outputDir)
+{
+    using namespace Qt::Literals::StringLiterals;
+    ExtractStats stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    // resolve every name through the inheritance chain, size by size: a
+    // parent only contributes files whose size no folder kept so far for
+    // that icon matches, following the lookup rules of the specification
+    const auto originalTheme = m_theme->currentTheme();
+    QMap<QString, SourceFile> files;      // [key=relative path]->source
+    QMap<QString, QString> dirThemes;     // [key=relative dir]->source theme
+    QHash<QString, QList<DirStats>> covered; // [key=icon_name]->{kept folder, ...}
+    foreach (const auto &theme, inheritanceChain(themeName)) {
+        m_theme->changeTheme(theme);
+        const auto themePath = m_theme->themes().value(theme);
+        const auto dirStats = m_theme->dirStatistics();
+        foreach (const auto &iconName, iconNames) {
+            const auto before = covered.value(iconName);
+            foreach (const auto &entry, m_theme->iconEntries(iconName)) {
+                const bool matched = std::any_of(before.cbegin(),
+                                                 before.cend(),
+                                                 [&](const DirStats &dir) {
+                                                     return dir.matchesSize(entry.size,
+                                                                            entry.scale);
+                                                 });
+                if (matched) {
+                    continue;
+                }
+                covered[iconName].append(dirStats.value(entry.dir));
+                const auto relative = entry.dir + '/' + QFileInfo(entry.filePath).fileName();
+                if (!files.contains(relative)) {
+                    files.insert(relative, SourceFile{entry.filePath, themePath});
+                }
+                if (!dirThemes.contains(entry.dir)) {
+                    dirThemes.insert(entry.dir, theme);
+                }
+            }
+        }
+    }
+    m_theme->changeTheme(originalTheme);
+    foreach (const auto &iconName, iconNames) {
+        if (covered.contains(iconName)) {
+            stats.icons++;
+        } else {
+            stats.missingIcons.append(iconName);
+        }
+    }
+
+    // symlinks, to files or folders, are recreated verbatim when their target
+    // stays inside the theme, which is then copied as well; any other link is
+    // dereferenced
+    QList<CopyJob> jobs;
+    QList<QPair<QString, QString>> links; // (target, link)
+    QMap<QString, QString> dirLinks;      // [key=relative dir]->link target
+    QSet<QString> targetDirs;
+    QSet<QString> done;
+    const QDir outDir(outputDir);
+    QList<QPair<QString, SourceFile>> queue;
+    for (auto it = files.cbegin(); it != files.cend(); ++it) {
+        queue.append(qMakePair(it.key(), it.value()));
+    }
+    while (!queue.isEmpty()) {
+        const auto item = queue.takeFirst();
+        const auto relative = resolveDirLinks(item.second.root, item.first, &dirLinks);
+        const SourceFile source{QDir(item.second.root).filePath(relative), item.second.root};
+        if (done.contains(relative)) {
+            continue;
+        }
+        done.insert(relative);
+        const auto relativeDir = QFileInfo(relative).path();
+        targetDirs.insert(relativeDir);
+        const QFileInfo info(source.path);
+        if (info.isSymLink()) {
+            const auto linkTarget = readLink(source.path);
+            const auto targetRelative = QDir::cleanPath(relativeDir + '/' + linkTarget);
+            const auto targetPath = QDir(source.root).filePath(targetRelative);
+            if (!linkTarget.isEmpty() && QDir::isRelativePath(linkTarget)
+                && !targetRelative.startsWith("../"_L1) && targetRelative != ".."_L1
+                && QFileInfo(targetPath).isFile()) {
+                links.append(qMakePair(linkTarget, outDir.filePath(relative)));
+                queue.append(qMakePair(targetRelative, SourceFile{targetPath, source.root}));
+                continue;
+            }
+        }
+        jobs.append(CopyJob{source.path, outDir.filePath(relative)});
+    }
+    outDir.mkpath("."_L1);
+    foreach (const auto &dir, targetDirs) {
+        outDir.mkpath(dir);
+    }
+    for (auto it = dirLinks.cbegin(); it != dirLinks.cend(); ++it) {
+        outDir.mkpath(QFileInfo(it.key()).path());
+        links.append(qMakePair(it.value(), outDir.filePath(it.key())));
+    }
+
+    QElapsedTimer copyTimer;
+    copyTimer.start();
+    std::atomic<qint64> bytes{0};
+    std::atomic<int> errors{0};
+    QtConcurrent::blockingMap(jobs, [&](const CopyJob &job) {
+        qint64 copied = 0;
+        if (!copyFile(job.source, job.target, &copied)) {
+            errors++;
+        }
+        bytes += copied;
+    });
+    stats.copyElapsed = copyTimer.elapsed();
+    stats.files = jobs.count();
+    stats.bytes = bytes;
+    stats.errors = errors;
+
+    foreach (const auto &link, links) {
+        // a real folder in the way (several themes disagreeing) is an error
+        const QFileInfo existing(link.second);
+        if (existing.isSymLink() || !existing.isDir()) {
+            QFile::remove(link.second);
+        }
+        if (QFile::link(link.first, link.second)) {
+            stats.links++;
+        } else {
+            stats.errors++;
+        }
+    }
+
+    // regenerated index.theme: only the directories actually used, with
+    // their lines copied from the theme that provided them; no Inherits, as
+    // the fallbacks have already been copied in
+    QHash<QString, QMap<QString, QList<QString>>> indexSections; // [key=theme]->sections
+    foreach (const auto &theme, QSet<QString>(dirThemes.cbegin(), dirThemes.cend()) << themeName) {
+        indexSections.insert(theme, readIndexSections(themeIndexPath(theme)));
+    }
+    QSaveFile indexFile(outDir.absoluteFilePath("index.theme"_L1));
+    if (indexFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QTextStream out(&indexFile);
+        out << "[Icon Theme]\n";
+        bool hasName = false;
+        foreach (const auto &line, indexSections[themeName].value("Icon Theme"_L1)) {
+            const auto key = lineKey(line);
+            if (key == "Directories"_L1 || key == "ScaledDirectories"_L1
+                || key == "Inherits"_L1) {
+                continue;
+            }
+            hasName = hasName || key == "Name"_L1;
+            out << line << '\n';
+        }
+        if (!hasName) {
+            out << "Name=" << themeName << '\n';
+        }
+        // scaled folders stay in ScaledDirectories when their theme put them there
+        QList<QString> directories, scaledDirectories;
+        for (auto it = dirThemes.cbegin(); it != dirThemes.cend(); ++it) {
+            const QSettings sourceReader(themeIndexPath(it.value()), QSettings::IniFormat);
+            if (sourceReader.value("Icon Theme/ScaledDirectories"_L1)
+                    .toStringList()
+                    .contains(it.key())) {
+                scaledDirectories.append(it.key());
+            } else {
+                directories.append(it.key());
+            }
+        }
+        out << "Directories=" << directories.join(',') << '\n';
+        if (!scaledDirectories.isEmpty()) {
+            out << "ScaledDirectories=" << scaledDirectories.join(',') << '\n';
+        }
+        for (auto it = dirThemes.cbegin(); it != dirThemes.cend(); ++it) {
+            out << "\n[" << it.key() << "]\n";
+            foreach (const auto &line, indexSections[it.value()].value(it.key())) {
+                out << line << '\n';
+            }
+        }
+        out.flush();
+        if (!indexFile.commit()) {
+            stats.errors++;
+        }
+    } else {
+        stats.errors++;
+    }
+    stats.outputBytes = stats.bytes + QFileInfo(outDir.absoluteFilePath("index.theme"_L1)).size();
+    stats.elapsed = timer.elapsed();
+    return stats;
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2023-2024, Pedro López-Cabanillas
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef THEMEEXTRACTOR_H
+#define THEMEEXTRACTOR_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include "freedesktoptheme.h"
+
+struct ExtractStats
+{
+    int icons = 0;
+    int files = 0;
+    int links = 0;
+    int errors = 0;
+    qint64 bytes = 0;       // file contents copied
+    qint64 outputBytes = 0; // including index.theme
+    qint64 elapsed = 0;     // milliseconds, whole extraction
+    qint64 copyElapsed = 0; // milliseconds, file transfer only
+    QList<QString> missingIcons;
+};
+
+class ThemeExtractor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ThemeExtractor(FreedesktopTheme *theme, QObject *parent = nullptr);
+    ExtractStats extract(const QString &themeName,
+                         const QList<QString> &iconNames,
+                         const QString &outputDir);
+
+protected:
+    QList<QString> inheritanceChain(const QString &themeName) const;
+    QString themeIndexPath(const QString &themeName) const;
+
+private:
+    FreedesktopTheme *m_theme;
+};
+
+#endif // THEMEEXTRACTOR_H